@@ -2,7 +2,7 @@
 /**
  * @file gpioSample.c
  *
- * Sample app making use of the helper lib (gpio_iot) to drive CF3-GPIO on IoT0 card for mangOH Green/Red
+ * Sample app making use of the gpioIot service (gpioIotService app) to drive CF3-GPIO on IoT0 card for mangOH Green/Red
  *	Scenario :
  *		GPIO_2 and GPIO_4 drive 2 LEDs to blink alternatively
  *		GPIO_1 is configured as an input (switch) to toggle another LED driven by GPIO_3
@@ -15,19 +15,18 @@
 #include "legato.h"
 #include "interfaces.h"
 
-#include "gpio_iot.h"   //use the gpio_iot helper lib
-
 
 
 //Callback to handle level transition on GPIO_1
-static void OnGpio1Change(bool state, void *ctx)
+static void OnGpio1Change(uint32_t pin, bool state, void *ctx)
 {
-    LE_INFO("GPIO_1 State change %s", state?"TRUE":"FALSE");
+    LE_INFO("GPIO_%d State change %s", pin, state?"TRUE":"FALSE");
 
     //GPIO_1 button/switch has been pressed, just toggle the LED driven by GPIO_3
-    bool status = gpio_iot_Read(3);
+    bool status = false;
+    gpioIot_Read(3, &status);
 	status = !status;
-	gpio_iot_SetOutput(3, status);
+	gpioIot_SetOutput(3, status);
 }
 
 
@@ -36,21 +35,17 @@ void Blink()
 {
 	//Blink scenario (driven by timer) : alternating the GPIO_2 and GPIO_4 (they blink oppositely)
 
-	//Retrieve the output level of GPIO_2
-    bool state = gpio_iot_Read(2);
-
-	gpio_iot_Read(4);   //just trace the output level of GPIO_4 to logread
-
-	//Set GPIO_4 output to be the same level as GPIO_2
-	gpio_iot_SetOutput(4, state);
+	//Retrieve the level of all the GPIOs in a single call, served from the gpioIot service cache
+    gpioIot_Pin_t states = 0;
+    gpioIot_ReadPins(GPIOIOT_PIN_1 | GPIOIOT_PIN_2 | GPIOIOT_PIN_3 | GPIOIOT_PIN_4, &states);
 
-	//Reverse the output of GPIO_2
-    state = !state;
-	gpio_iot_SetOutput(2, state);
+    //just trace the level of the GPIOs to logread
+    LE_INFO("GPIO_1 : %d - GPIO_2 : %d - GPIO_3 : %d - GPIO_4 : %d",
+            (states & GPIOIOT_PIN_1) != 0, (states & GPIOIOT_PIN_2) != 0, (states & GPIOIOT_PIN_3) != 0, (states & GPIOIOT_PIN_4) != 0);
 
-    //just trace the output level of GPIO_1 & GPIO_3 to logread
-	gpio_iot_Read(1);
-	gpio_iot_Read(3);
+	//Set GPIO_4 output to be the same level as GPIO_2, and reverse the output of GPIO_2
+    gpioIot_Pin_t newStates = (states & GPIOIOT_PIN_2) ? GPIOIOT_PIN_4 : GPIOIOT_PIN_2;
+	gpioIot_WritePins(GPIOIOT_PIN_2 | GPIOIOT_PIN_4, newStates);
 
 	LE_INFO(" ");
 }
@@ -58,25 +53,24 @@ void Blink()
 
 COMPONENT_INIT
 {
-	//Initialize gpio_iot helper lib : Will be using IoT0 slot of the mangOH board
-    //this will set the target mangOH board type: setting in config tree : "/gpio_iot/mangohType"
-	gpio_iot_Init();
+	//The gpioIot service owns the gpio_iot helper lib : Will be using IoT0 slot of the mangOH board
+    //the target mangOH board type is set in the service config tree : "gpioIotService:/gpio_iot/mangohType"
 
 	//GPIO_1 as an input : connect a switch/PushButton to GPIO_1 (Pin24 of IoT card) and GND
-	gpio_iot_SetInput(1, true);
-	gpio_iot_EnablePullUp(1);   //enable the internal pull-up resistor
+	gpioIot_SetInput(1, true);
+	gpioIot_EnablePullUp(1);   //enable the internal pull-up resistor
     
 	//if the button is pushed, then call OnGpio1Change callback function
-	gpio_iot_AddChangeEventHandler(1, GPIO_IOT_EDGE_RISING, OnGpio1Change, NULL, 100);
+	gpioIot_AddChangeHandler(GPIOIOT_PIN_1, GPIOIOT_EDGE_RISING, OnGpio1Change, NULL);
 
 	//GPIO_2 is an output : Use a transistor to drive the LED.
-	gpio_iot_SetPushPullOutput(2, true, true);
+	gpioIot_SetPushPullOutput(2, true, true);
 
 	//GPIO_3 is an output : Use a transistor to drive a LED/Motor.
-	gpio_iot_SetPushPullOutput(3, true, true);
+	gpioIot_SetPushPullOutput(3, true, true);
 
 	//GPIO_4 is an output : Use a transistor to drive the LED.
-	gpio_iot_SetPushPullOutput(4, true, true);
+	gpioIot_SetPushPullOutput(4, true, true);
 
   
 	//Set timer to animate LEDs
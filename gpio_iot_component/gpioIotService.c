@@ -0,0 +1,545 @@
+//-------------------------------------------------------------------------------------------------
+/**
+ * @file gpioIotService.c
+ *
+ * Legato service exposing the IoT0 GPIOs (gpioIot.api) on top of the gpio_iot helper lib.
+ *  This is the only process bound to the le_gpioPinxx interfaces of gpioService.
+ *  It holds the authoritative state of the 4 IoT0 GPIOs :
+ *      - outputs are cached when they are written,
+ *      - inputs are watched with a single le_gpio change handler per pin and cached on every edge.
+ *  Reads from client apps are served from that cache, change events are dispatched to every
+ *  subscribed client, so N client apps cost a single set of gpioService bindings and handlers.
+ *  It also runs the fixed-rate captures (logic-analyzer mode) into a preallocated buffer.
+ */
+//-------------------------------------------------------------------------------------------------
+
+#include "legato.h"
+#include "interfaces.h"
+
+#include "gpio_iot.h"
+
+//mangOH IOT card only handle up to 4 CF3-GPIO
+#define PIN_COUNT               GPIOIOT_PIN_COUNT
+
+//all the pins of the IoT0 card
+#define PIN_MASK_ALL            ((1 << PIN_COUNT) - 1)
+
+//bit of a GPIO (1-4) in a gpioIot_Pin_t mask
+#define PIN_BIT(gpioNumber)     (1 << ((gpioNumber) - 1))
+
+//sampling period requested to gpioService for the pins not supporting interrupts
+#define BACKEND_SAMPLE_MS       100
+
+//change subscriptions preallocated for all the clients
+#define MAX_SUBSCRIPTIONS       16
+
+//capture subscriptions preallocated for all the clients
+#define MAX_CAPTURE_SUBSCRIPTIONS   4
+
+//cached state of an IoT0 GPIO
+typedef struct
+{
+    bool                                configured;         //set as input or output through this service
+    bool                                isInput;
+    bool                                cached;             //state is kept up to date : output driven here, input with a change handler
+    bool                                state;              //true=activated, false=deactivated
+    gpio_iot_ChangeEventHandlerRef_t    backendHandlerRef;  //le_gpio change handler of an input
+} PinCache_t;
+
+//change subscription of a client
+typedef struct
+{
+    gpioIot_Pin_t                   pinMask;
+    gpioIot_Edge_t                  edge;
+    gpioIot_ChangeHandlerFunc_t     handlerPtr;
+    void*                           contextPtr;
+    gpioIot_ChangeHandlerRef_t      ref;
+    le_dls_Link_t                   link;
+} Subscription_t;
+
+//capture subscription of a client
+typedef struct
+{
+    gpioIot_CaptureHandlerFunc_t    handlerPtr;
+    void*                           contextPtr;
+    gpioIot_CaptureDoneHandlerRef_t ref;
+    le_dls_Link_t                   link;
+} CaptureSubscription_t;
+
+
+//state of the IoT0 GPIOs shared by all the clients
+static PinCache_t                   _pinCache[PIN_COUNT];
+
+//change subscriptions of all the clients
+static le_dls_List_t                _subscriptionList = LE_DLS_LIST_INIT;
+static le_mem_PoolRef_t             _subscriptionPool;
+static le_ref_MapRef_t              _subscriptionRefMap;
+
+//capture subscriptions of all the clients
+static le_dls_List_t                _captureSubscriptionList = LE_DLS_LIST_INIT;
+static le_mem_PoolRef_t             _captureSubscriptionPool;
+static le_ref_MapRef_t              _captureSubscriptionRefMap;
+
+//result of the last capture, samples are kept in the gpio_iot arena
+static const uint8_t*               _captureBufferPtr;
+static gpio_iot_CaptureStats_t      _captureStats;
+
+
+//Check that the GPIO number is in range (1 - 4)
+static bool IsValidPin(uint32_t gpioNumber)
+{
+    return (gpioNumber > 0 && gpioNumber <= PIN_COUNT);
+}
+
+//Check that the mask selects at least one GPIO and nothing else
+static bool IsValidPinMask(gpioIot_Pin_t pinMask)
+{
+    return (pinMask != 0 && (pinMask & ~PIN_MASK_ALL) == 0);
+}
+
+//Check whether a level change matches the edge requested by a client
+static bool IsMatchingEdge(gpioIot_Edge_t edge, bool state)
+{
+    switch (edge)
+    {
+        case GPIOIOT_EDGE_BOTH:
+            return true;
+        case GPIOIOT_EDGE_RISING:
+            return state;
+        case GPIOIOT_EDGE_FALLING:
+            return !state;
+        default:
+            return false;
+    }
+}
+
+//Check whether a GPIO (1 - 4) is known to be an input, which can't be driven
+static bool IsInputPin(uint32_t gpioNumber)
+{
+    return (_pinCache[gpioNumber-1].configured && _pinCache[gpioNumber-1].isInput);
+}
+
+//Level of a GPIO (1 - 4) : from the cache when it is kept up to date, from gpioService otherwise
+static bool ReadPin(uint32_t gpioNumber)
+{
+    PinCache_t* pinPtr = &_pinCache[gpioNumber-1];
+
+    if (pinPtr->cached)
+    {
+        return pinPtr->state;
+    }
+
+    return gpio_iot_Read(gpioNumber);
+}
+
+//Drive an output, skipping the call to gpioService when the cache shows the level is already set
+static le_result_t WritePin(uint32_t gpioNumber, bool bActivate)
+{
+    PinCache_t* pinPtr = &_pinCache[gpioNumber-1];
+
+    if (IsInputPin(gpioNumber))
+    {
+        return LE_NOT_PERMITTED;
+    }
+
+    if (pinPtr->cached && pinPtr->state == bActivate)
+    {
+        return LE_OK;
+    }
+
+    le_result_t result = gpio_iot_SetOutput(gpioNumber, bActivate);
+
+    if (result == LE_OK && pinPtr->cached)
+    {
+        pinPtr->state = bActivate;
+    }
+
+    return result;
+}
+
+//Remove the le_gpio change handler of a GPIO that is no longer an input
+static void ReleaseBackendHandler(uint32_t gpioNumber)
+{
+    PinCache_t* pinPtr = &_pinCache[gpioNumber-1];
+
+    if (pinPtr->backendHandlerRef)
+    {
+        gpio_iot_RemoveChangeEventHandler(gpioNumber, pinPtr->backendHandlerRef);
+        pinPtr->backendHandlerRef = NULL;
+    }
+}
+
+//Single le_gpio change handler of an input : update the cache and dispatch to the subscribed clients
+static void OnBackendChange(bool state, void *contextPtr)
+{
+    uint32_t gpioNumber = (uint32_t)(uintptr_t)contextPtr;
+
+    _pinCache[gpioNumber-1].state = state;
+
+    le_dls_Link_t* linkPtr = le_dls_Peek(&_subscriptionList);
+
+    while (linkPtr)
+    {
+        Subscription_t* subscriptionPtr = CONTAINER_OF(linkPtr, Subscription_t, link);
+
+        if ((subscriptionPtr->pinMask & PIN_BIT(gpioNumber)) && IsMatchingEdge(subscriptionPtr->edge, state))
+        {
+            subscriptionPtr->handlerPtr(gpioNumber, state, subscriptionPtr->contextPtr);
+        }
+
+        linkPtr = le_dls_PeekNext(&_subscriptionList, linkPtr);
+    }
+}
+
+//End of a capture : keep the samples for GetCaptureData and notify the subscribed clients
+static void OnCaptureDone(le_result_t result, const uint8_t *bufferPtr, const gpio_iot_CaptureStats_t *statsPtr, void *contextPtr)
+{
+    _captureBufferPtr = bufferPtr;
+    _captureStats = *statsPtr;
+
+    le_dls_Link_t* linkPtr = le_dls_Peek(&_captureSubscriptionList);
+
+    while (linkPtr)
+    {
+        CaptureSubscription_t* subscriptionPtr = CONTAINER_OF(linkPtr, CaptureSubscription_t, link);
+
+        subscriptionPtr->handlerPtr(result, statsPtr->sampleCount, statsPtr->achievedRateMilliHz,
+                                    statsPtr->missedDeadlines, subscriptionPtr->contextPtr);
+
+        linkPtr = le_dls_PeekNext(&_captureSubscriptionList, linkPtr);
+    }
+}
+
+//CPU the capture thread is pinned to : the last one, away from the CPU handling most of the interrupts
+static int32_t CaptureCpu()
+{
+    long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (cpuCount > 1) ? (int32_t)(cpuCount - 1) : 0;
+}
+
+
+//Configure the specified GPIO (1-4) as Output
+le_result_t gpioIot_SetPushPullOutput(uint32_t pin, bool activeHigh, bool initValue)
+{
+    if (!IsValidPin(pin))
+    {
+        return LE_BAD_PARAMETER;
+    }
+
+    ReleaseBackendHandler(pin);
+
+    PinCache_t* pinPtr = &_pinCache[pin-1];
+    le_result_t result = gpio_iot_SetPushPullOutput(pin, activeHigh, initValue);
+
+    //the pin state is unknown if gpioService refused the configuration
+    pinPtr->configured = (result == LE_OK);
+    pinPtr->isInput = false;
+    pinPtr->cached = (result == LE_OK);
+    pinPtr->state = initValue;
+
+    return result;
+}
+
+//Configure the specified GPIO (1-4) as Input, watched by a single le_gpio change handler
+le_result_t gpioIot_SetInput(uint32_t pin, bool activeHigh)
+{
+    if (!IsValidPin(pin))
+    {
+        return LE_BAD_PARAMETER;
+    }
+
+    ReleaseBackendHandler(pin);
+
+    PinCache_t* pinPtr = &_pinCache[pin-1];
+    le_result_t result = gpio_iot_SetInput(pin, activeHigh);
+
+    pinPtr->configured = (result == LE_OK);
+    pinPtr->isInput = true;
+    pinPtr->cached = false;
+
+    if (result != LE_OK)
+    {
+        return result;
+    }
+
+    pinPtr->state = gpio_iot_Read(pin);
+    pinPtr->backendHandlerRef = gpio_iot_AddChangeEventHandler(pin, GPIO_IOT_EDGE_BOTH, OnBackendChange,
+                                                                (void*)(uintptr_t)pin, BACKEND_SAMPLE_MS);
+
+    //without change handler the cache would go stale : reads of this pin go to gpioService
+    if (pinPtr->backendHandlerRef)
+    {
+        pinPtr->cached = true;
+    }
+    else
+    {
+        LE_WARN("GPIO_%d - no change handler, level read from gpioService and changes not reported", pin);
+    }
+
+    return LE_OK;
+}
+
+//Enable the pull-up resistor of the specified GPIO (1-4)
+le_result_t gpioIot_EnablePullUp(uint32_t pin)
+{
+    if (!IsValidPin(pin))
+    {
+        return LE_BAD_PARAMETER;
+    }
+
+    return gpio_iot_EnablePullUp(pin);
+}
+
+//Enable the pull-down resistor of the specified GPIO (1-4)
+le_result_t gpioIot_EnablePullDown(uint32_t pin)
+{
+    if (!IsValidPin(pin))
+    {
+        return LE_BAD_PARAMETER;
+    }
+
+    return gpio_iot_EnablePullDown(pin);
+}
+
+//Set the output level of the specified GPIO (1-4)
+le_result_t gpioIot_SetOutput(uint32_t pin, bool activate)
+{
+    if (!IsValidPin(pin))
+    {
+        return LE_BAD_PARAMETER;
+    }
+
+    return WritePin(pin, activate);
+}
+
+//Read the level of the specified GPIO (1-4)
+le_result_t gpioIot_Read(uint32_t pin, bool* statePtr)
+{
+    if (!IsValidPin(pin))
+    {
+        return LE_BAD_PARAMETER;
+    }
+
+    *statePtr = ReadPin(pin);
+
+    return LE_OK;
+}
+
+//Read the level of several GPIOs at once
+le_result_t gpioIot_ReadPins(gpioIot_Pin_t pinMask, gpioIot_Pin_t* statesPtr)
+{
+    if (!IsValidPinMask(pinMask))
+    {
+        return LE_BAD_PARAMETER;
+    }
+
+    gpioIot_Pin_t states = 0;
+    uint32_t gpioNumber;
+
+    for (gpioNumber = 1; gpioNumber <= PIN_COUNT; gpioNumber++)
+    {
+        if ((pinMask & PIN_BIT(gpioNumber)) && ReadPin(gpioNumber))
+        {
+            states |= PIN_BIT(gpioNumber);
+        }
+    }
+
+    *statesPtr = states;
+
+    return LE_OK;
+}
+
+//Set the output level of several GPIOs at once
+le_result_t gpioIot_WritePins(gpioIot_Pin_t pinMask, gpioIot_Pin_t states)
+{
+    if (!IsValidPinMask(pinMask))
+    {
+        return LE_BAD_PARAMETER;
+    }
+
+    uint32_t gpioNumber;
+
+    //refuse the whole request rather than driving only part of the pins
+    for (gpioNumber = 1; gpioNumber <= PIN_COUNT; gpioNumber++)
+    {
+        if ((pinMask & PIN_BIT(gpioNumber)) && IsInputPin(gpioNumber))
+        {
+            return LE_NOT_PERMITTED;
+        }
+    }
+
+    le_result_t result = LE_OK;
+
+    for (gpioNumber = 1; gpioNumber <= PIN_COUNT; gpioNumber++)
+    {
+        if (pinMask & PIN_BIT(gpioNumber))
+        {
+            le_result_t pinResult = WritePin(gpioNumber, (states & PIN_BIT(gpioNumber)) != 0);
+
+            if (result == LE_OK)
+            {
+                result = pinResult;
+            }
+        }
+    }
+
+    return result;
+}
+
+//Subscribe a client to the level changes of the input GPIOs in pinMask
+gpioIot_ChangeHandlerRef_t gpioIot_AddChangeHandler
+(
+    gpioIot_Pin_t pinMask,
+    gpioIot_Edge_t edge,
+    gpioIot_ChangeHandlerFunc_t handlerPtr,
+    void* contextPtr
+)
+{
+    if (!IsValidPinMask(pinMask) || handlerPtr == NULL)
+    {
+        LE_ERROR("Invalid change subscription : pinMask 0x%x", pinMask);
+        return NULL;
+    }
+
+    Subscription_t* subscriptionPtr = le_mem_ForceAlloc(_subscriptionPool);
+
+    subscriptionPtr->pinMask = pinMask;
+    subscriptionPtr->edge = edge;
+    subscriptionPtr->handlerPtr = handlerPtr;
+    subscriptionPtr->contextPtr = contextPtr;
+    subscriptionPtr->ref = le_ref_CreateRef(_subscriptionRefMap, subscriptionPtr);
+    subscriptionPtr->link = LE_DLS_LINK_INIT;
+
+    le_dls_Queue(&_subscriptionList, &subscriptionPtr->link);
+
+    return subscriptionPtr->ref;
+}
+
+//Unsubscribe a client from level changes
+void gpioIot_RemoveChangeHandler(gpioIot_ChangeHandlerRef_t handlerRef)
+{
+    Subscription_t* subscriptionPtr = le_ref_Lookup(_subscriptionRefMap, handlerRef);
+
+    if (subscriptionPtr == NULL)
+    {
+        LE_ERROR("Invalid change handler reference %p", handlerRef);
+        return;
+    }
+
+    le_dls_Remove(&_subscriptionList, &subscriptionPtr->link);
+    le_ref_DeleteRef(_subscriptionRefMap, handlerRef);
+    le_mem_Release(subscriptionPtr);
+}
+
+//Start a fixed-rate capture into the gpio_iot arena
+le_result_t gpioIot_StartCapture(gpioIot_Pin_t pinMask, uint32_t rateHz, uint32_t sampleCount)
+{
+    if (!IsValidPinMask(pinMask))
+    {
+        return LE_BAD_PARAMETER;
+    }
+
+    le_result_t result = gpio_iot_StartCapture(pinMask, rateHz, sampleCount, NULL, 0, CaptureCpu(), OnCaptureDone, NULL);
+
+    if (result == LE_OK)
+    {
+        _captureBufferPtr = NULL;
+        memset(&_captureStats, 0, sizeof(_captureStats));
+    }
+
+    return result;
+}
+
+//Stop the capture in progress
+void gpioIot_StopCapture()
+{
+    gpio_iot_StopCapture();
+}
+
+//Subscribe a client to capture completion
+gpioIot_CaptureDoneHandlerRef_t gpioIot_AddCaptureDoneHandler
+(
+    gpioIot_CaptureHandlerFunc_t handlerPtr,
+    void* contextPtr
+)
+{
+    if (handlerPtr == NULL)
+    {
+        LE_ERROR("Invalid capture subscription");
+        return NULL;
+    }
+
+    CaptureSubscription_t* subscriptionPtr = le_mem_ForceAlloc(_captureSubscriptionPool);
+
+    subscriptionPtr->handlerPtr = handlerPtr;
+    subscriptionPtr->contextPtr = contextPtr;
+    subscriptionPtr->ref = le_ref_CreateRef(_captureSubscriptionRefMap, subscriptionPtr);
+    subscriptionPtr->link = LE_DLS_LINK_INIT;
+
+    le_dls_Queue(&_captureSubscriptionList, &subscriptionPtr->link);
+
+    return subscriptionPtr->ref;
+}
+
+//Unsubscribe a client from capture completion
+void gpioIot_RemoveCaptureDoneHandler(gpioIot_CaptureDoneHandlerRef_t handlerRef)
+{
+    CaptureSubscription_t* subscriptionPtr = le_ref_Lookup(_captureSubscriptionRefMap, handlerRef);
+
+    if (subscriptionPtr == NULL)
+    {
+        LE_ERROR("Invalid capture handler reference %p", handlerRef);
+        return;
+    }
+
+    le_dls_Remove(&_captureSubscriptionList, &subscriptionPtr->link);
+    le_ref_DeleteRef(_captureSubscriptionRefMap, handlerRef);
+    le_mem_Release(subscriptionPtr);
+}
+
+//Read a chunk of the packed samples of the last capture
+le_result_t gpioIot_GetCaptureData(uint32_t offset, uint8_t* dataPtr, size_t* dataSizePtr)
+{
+    if (gpio_iot_IsCapturing())
+    {
+        return LE_BUSY;
+    }
+
+    size_t captureBytes = _captureBufferPtr ? GPIO_IOT_CAPTURE_BYTES(_captureStats.sampleCount) : 0;
+
+    if (offset >= captureBytes)
+    {
+        *dataSizePtr = 0;
+        return LE_OUT_OF_RANGE;
+    }
+
+    size_t chunkBytes = captureBytes - offset;
+
+    if (chunkBytes > *dataSizePtr)
+    {
+        chunkBytes = *dataSizePtr;
+    }
+
+    memcpy(dataPtr, _captureBufferPtr + offset, chunkBytes);
+    *dataSizePtr = chunkBytes;
+
+    return LE_OK;
+}
+
+
+COMPONENT_INIT
+{
+    //this will set the target mangOH board type: setting in config tree : "/gpio_iot/mangohType"
+    gpio_iot_Init();
+
+    _subscriptionPool = le_mem_CreatePool("GpioIotSubscriptions", sizeof(Subscription_t));
+    le_mem_ExpandPool(_subscriptionPool, MAX_SUBSCRIPTIONS);
+    _subscriptionRefMap = le_ref_CreateMap("GpioIotSubscriptionRefs", MAX_SUBSCRIPTIONS);
+
+    _captureSubscriptionPool = le_mem_CreatePool("GpioIotCaptureSubscriptions", sizeof(CaptureSubscription_t));
+    le_mem_ExpandPool(_captureSubscriptionPool, MAX_CAPTURE_SUBSCRIPTIONS);
+    _captureSubscriptionRefMap = le_ref_CreateMap("GpioIotCaptureSubscriptionRefs", MAX_CAPTURE_SUBSCRIPTIONS);
+
+    LE_INFO("gpioIot service ready");
+}
@@ -11,6 +11,10 @@
  */
 //-------------------------------------------------------------------------------------------------
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     //pthread_setaffinity_np
+#endif
+
 #include "legato.h"
 #include "interfaces.h"
 
@@ -56,6 +60,7 @@ typedef le_result_t (* pfnIntBoolRetleresult)(int, bool);
 typedef le_result_t (* pfnNoArgRetleresult)();
 typedef le_result_t (* pfnIntRetleresult)(int);
 typedef gpio_iot_ChangeEventHandlerRef_t (* pfnIntCbCtxtIntRetChangeEventhRef)(int, gpio_iot_ChangeCallbackFunc_t, void *, int32_t);
+typedef void (* pfnChangeEventhRefRetVoid)(gpio_iot_ChangeEventHandlerRef_t);
 typedef gpio_iot_Edge_t (* pfnNoArgRetEdge)(); 
 
 //board names
@@ -144,6 +149,15 @@ gpio_Function_t       _gpio_functions[] = {
                                 {LE_GPIO_FUNC(8, 8, 8, AddChangeEventHandler)}       //mapping le_gpio_AddChangeEventHandler function for GPIO_4 (mRed, mGreen , mYellow)
                             }
     },
+    {
+        .functionNamePtr = "RemoveChangeEventHandler",
+        .gpioFunctionPtr =  {
+                                {LE_GPIO_FUNC(42, 42, 42, RemoveChangeEventHandler)},   //mapping le_gpio_RemoveChangeEventHandler function for GPIO_1 (mRed, mGreen , mYellow)
+                                {LE_GPIO_FUNC(13, 33, 13, RemoveChangeEventHandler)},   //mapping le_gpio_RemoveChangeEventHandler function for GPIO_2 (mRed, mGreen , mYellow)
+                                {LE_GPIO_FUNC(7, 13, 7, RemoveChangeEventHandler)},     //mapping le_gpio_RemoveChangeEventHandler function for GPIO_3 (mRed, mGreen , mYellow)
+                                {LE_GPIO_FUNC(8, 8, 8, RemoveChangeEventHandler)}       //mapping le_gpio_RemoveChangeEventHandler function for GPIO_4 (mRed, mGreen , mYellow)
+                            }
+    },
     {
         .functionNamePtr = "EnablePullUp",
         .gpioFunctionPtr =  {
@@ -327,7 +341,7 @@ gpio_iot_PullUpDown_t gpio_iot_GetPullUpDown(uint32_t gpioNumber)
 
 //To Set a GPIO "As Output"
 //Call the proper le_gpioPinxx_SetPushPullOutput function based on the provided IoT0-GPIO pin# (1 - 4)
-void gpio_iot_SetPushPullOutput(uint32_t gpioNumber, bool bActiveHigh, bool bInitValue)
+le_result_t gpio_iot_SetPushPullOutput(uint32_t gpioNumber, bool bActiveHigh, bool bInitValue)
 {
     gpio_iot_Polarity_t polarity = bActiveHigh ? GPIO_IOT_ACTIVE_HIGH : GPIO_IOT_ACTIVE_LOW;
 
@@ -337,20 +351,22 @@ void gpio_iot_SetPushPullOutput(uint32_t gpioNumber, bool bActiveHigh, bool bIni
     if (gpioFunctionPtr)
     {
         pfnIntBoolRetleresult    pFn = (pfnIntBoolRetleresult) gpioFunctionPtr->leGpioPtr;
-        pFn(polarity, bInitValue);
+        le_result_t result = pFn(polarity, bInitValue);
 
         gpio_iot_Read(gpioNumber);
 
         gpio_iot_IsInput(gpioNumber);
 
+        return result;
     }
-    
+
+    return LE_FAULT;
 }
 
 
 //Activate/Deactivate an output
 //Call the proper le_gpioPinxx_Activate / le_gpioPinxx_Deactivate function based on the provided IoT0-GPIO pin# (1 - 4)
-void gpio_iot_SetOutput(uint32_t gpioNumber, bool bActivate)
+le_result_t gpio_iot_SetOutput(uint32_t gpioNumber, bool bActivate)
 {
     char name[32] = {0};
 
@@ -368,15 +384,17 @@ void gpio_iot_SetOutput(uint32_t gpioNumber, bool bActivate)
     if (gpioFunctionPtr)
     {
         pfnNoArgRetleresult    pFn = (pfnNoArgRetleresult) gpioFunctionPtr->leGpioPtr;
-        pFn();
+        return pFn();
     }
+
+    return LE_FAULT;
 }
 
 
 
 //Set a GPIO as "an Input"
 //Call the proper le_gpioPinxx_SetInput function based on the provided IoT0-GPIO pin# (1 - 4)
-void gpio_iot_SetInput(uint32_t gpioNumber, bool bPolarityHigh)
+le_result_t gpio_iot_SetInput(uint32_t gpioNumber, bool bPolarityHigh)
 {
     const char* name = "SetInput";
     gpio_le_function_t* gpioFunctionPtr = GetFunctionPtr(name, gpioNumber);
@@ -387,7 +405,7 @@ void gpio_iot_SetInput(uint32_t gpioNumber, bool bPolarityHigh)
 
         gpio_iot_Polarity_t polarity = bPolarityHigh ? GPIO_IOT_ACTIVE_HIGH : GPIO_IOT_ACTIVE_LOW;
 
-        pFn(polarity);
+        le_result_t result = pFn(polarity);
 
         gpio_iot_Read(gpioNumber);
 
@@ -396,7 +414,11 @@ void gpio_iot_SetInput(uint32_t gpioNumber, bool bPolarityHigh)
         gpio_iot_GetPolarity(gpioNumber);
 
         gpio_iot_GetPullUpDown(gpioNumber);
+
+        return result;
     }
+
+    return LE_FAULT;
 }
 
 //Call the proper le_gpioPinxx_AddChangeEventHandler function based on the provided IoT0-GPIO pin# (1 - 4)
@@ -422,6 +444,20 @@ gpio_iot_ChangeEventHandlerRef_t  gpio_iot_AddChangeEventHandler
     return NULL;
 }
 
+//Call the proper le_gpioPinxx_RemoveChangeEventHandler function based on the provided IoT0-GPIO pin# (1 - 4)
+void gpio_iot_RemoveChangeEventHandler(uint32_t gpioNumber, gpio_iot_ChangeEventHandlerRef_t handlerRef)
+{
+    const char* name = "RemoveChangeEventHandler";
+    gpio_le_function_t* gpioFunctionPtr = GetFunctionPtr(name, gpioNumber);
+
+    if (gpioFunctionPtr)
+    {
+        pfnChangeEventhRefRetVoid    pFn = (pfnChangeEventhRefRetVoid) gpioFunctionPtr->leGpioPtr;
+
+        pFn(handlerRef);
+    }
+}
+
 //Call the proper le_gpioPinxx_EnablePullUp function based on the provided IoT0-GPIO pin# (1 - 4)
 le_result_t     gpio_iot_EnablePullUp(uint32_t gpioNumber)
 {
@@ -510,3 +546,330 @@ void gpio_iot_Init()
     }
 }
 
+
+//Capture : a single capture at a time, sampled by a dedicated thread
+typedef struct
+{
+    int                         valueFd[MAX_GPIO_COUNT];        //sysfs value file, -1 for the GPIOs not captured
+    uint64_t                    periodNs;
+    uint32_t                    sampleCount;
+    uint8_t*                    bufferPtr;
+    int32_t                     cpu;
+    volatile bool               stopRequested;
+    bool                        running;
+    le_result_t                 result;
+    gpio_iot_CaptureStats_t     stats;
+    le_thread_Ref_t             ownerThreadRef;
+    gpio_iot_CaptureDoneFunc_t  handlerPtr;
+    void*                       contextPtr;
+} gpio_iot_Capture_t;
+
+static gpio_iot_Capture_t   _gpio_capture;
+
+//Preallocated buffer used when the caller does not supply one
+static uint8_t              _gpio_capture_arena[GPIO_IOT_CAPTURE_ARENA_BYTES];
+
+
+//Nanoseconds elapsed from startPtr to endPtr
+static int64_t ElapsedNs(const struct timespec* startPtr, const struct timespec* endPtr)
+{
+    return (int64_t)(endPtr->tv_sec - startPtr->tv_sec) * 1000000000LL + (endPtr->tv_nsec - startPtr->tv_nsec);
+}
+
+//Move an absolute deadline forward
+static void AddNs(struct timespec* timePtr, uint64_t ns)
+{
+    uint64_t nsec = timePtr->tv_nsec + ns;
+
+    timePtr->tv_sec += nsec / 1000000000ULL;
+    timePtr->tv_nsec = nsec % 1000000000ULL;
+}
+
+//Directory where gpioService exports the pins : v2 alias layout when the platform has it (e.g. WP76xx), legacy layout otherwise
+static const char* GetGpioSysfsDir()
+{
+    if (access(GPIO_IOT_SYSFS_V2_DIR, F_OK) == 0)
+    {
+        return GPIO_IOT_SYSFS_V2_DIR;
+    }
+
+    return GPIO_IOT_SYSFS_DIR;
+}
+
+//Store a 4-bit sample in the packed buffer, the buffer is cleared before the capture
+static void StoreSample(uint8_t* bufferPtr, uint32_t sampleIdx, uint8_t sample)
+{
+    bufferPtr[sampleIdx / 2] |= sample << ((sampleIdx % 2) * 4);
+}
+
+//Close the sysfs value files of a capture
+static void CloseValueFiles(gpio_iot_Capture_t* capturePtr)
+{
+    int gpioIdx;
+
+    for (gpioIdx = 0; gpioIdx < MAX_GPIO_COUNT; gpioIdx++)
+    {
+        if (capturePtr->valueFd[gpioIdx] >= 0)
+        {
+            close(capturePtr->valueFd[gpioIdx]);
+            capturePtr->valueFd[gpioIdx] = -1;
+        }
+    }
+}
+
+//Run in the thread which started the capture : report the result
+static void CaptureDone(void* param1Ptr, void* param2Ptr)
+{
+    gpio_iot_Capture_t* capturePtr = (gpio_iot_Capture_t*) param1Ptr;
+
+    capturePtr->running = false;
+
+    LE_INFO("Capture done - %u samples - %u.%03u Hz - %u missed deadlines", capturePtr->stats.sampleCount,
+            capturePtr->stats.achievedRateMilliHz / 1000, capturePtr->stats.achievedRateMilliHz % 1000,
+            capturePtr->stats.missedDeadlines);
+
+    if (capturePtr->handlerPtr)
+    {
+        capturePtr->handlerPtr(capturePtr->result, capturePtr->bufferPtr, &capturePtr->stats, capturePtr->contextPtr);
+    }
+}
+
+//Capture thread : sample the selected GPIOs on an absolute time grid
+//Each GPIO is read with a pread on its sysfs value file opened beforehand : no IPC, no allocation nor log per sample
+static void* CaptureThread(void* contextPtr)
+{
+    gpio_iot_Capture_t* capturePtr = (gpio_iot_Capture_t*) contextPtr;
+    int gpioIdx;
+
+    if (capturePtr->cpu >= 0)
+    {
+        cpu_set_t cpuSet;
+
+        CPU_ZERO(&cpuSet);
+        CPU_SET(capturePtr->cpu, &cpuSet);
+
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0)
+        {
+            LE_WARN("Capture thread can't be pinned to CPU %d", capturePtr->cpu);
+        }
+    }
+
+    memset(capturePtr->bufferPtr, 0, GPIO_IOT_CAPTURE_BYTES(capturePtr->sampleCount));
+
+    struct timespec deadline;
+    struct timespec now;
+    struct timespec firstSample = {0};
+    struct timespec lastSample = {0};
+    uint32_t        sampleIdx = 0;
+    uint32_t        takenCount = 0;
+
+    capturePtr->result = LE_OK;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (sampleIdx < capturePtr->sampleCount && !capturePtr->stopRequested)
+    {
+        //a signal must not make the sample be taken ahead of its slot
+        int sleepError;
+
+        do
+        {
+            sleepError = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        }
+        while (sleepError == EINTR);
+
+        if (sleepError != 0)
+        {
+            capturePtr->result = LE_FAULT;
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &lastSample);
+
+        if (takenCount == 0)
+        {
+            firstSample = lastSample;
+        }
+
+        uint8_t sample = 0;
+
+        for (gpioIdx = 0; gpioIdx < MAX_GPIO_COUNT; gpioIdx++)
+        {
+            char value;
+
+            if (capturePtr->valueFd[gpioIdx] < 0)
+            {
+                continue;
+            }
+
+            if (pread(capturePtr->valueFd[gpioIdx], &value, 1, 0) != 1)
+            {
+                capturePtr->result = LE_FAULT;
+                break;
+            }
+
+            if (value == '1')
+            {
+                sample |= 1 << gpioIdx;
+            }
+        }
+
+        if (capturePtr->result != LE_OK)
+        {
+            break;
+        }
+
+        StoreSample(capturePtr->bufferPtr, sampleIdx++, sample);
+        takenCount++;
+
+        AddNs(&deadline, capturePtr->periodNs);
+
+        if (sampleIdx >= capturePtr->sampleCount)
+        {
+            break;
+        }
+
+        //slots already over can't be sampled anymore : hold the last sample on them so the trace
+        //stays on the time grid, count them as missed and wait for the next slot to come
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        while (sampleIdx < capturePtr->sampleCount && ElapsedNs(&deadline, &now) >= 0)
+        {
+            StoreSample(capturePtr->bufferPtr, sampleIdx++, sample);
+            capturePtr->stats.missedDeadlines++;
+            AddNs(&deadline, capturePtr->periodNs);
+        }
+    }
+
+    CloseValueFiles(capturePtr);
+
+    capturePtr->stats.sampleCount = sampleIdx;
+
+    int64_t elapsedNs = ElapsedNs(&firstSample, &lastSample);
+
+    if (takenCount > 1 && elapsedNs > 0)
+    {
+        capturePtr->stats.achievedRateMilliHz = (uint32_t)((double)(takenCount - 1) * 1e12 / (double)elapsedNs);
+    }
+
+    if (capturePtr->result == LE_OK && capturePtr->stopRequested)
+    {
+        capturePtr->result = LE_TERMINATED;
+    }
+
+    le_event_QueueFunctionToThread(capturePtr->ownerThreadRef, CaptureDone, capturePtr, NULL);
+
+    return NULL;
+}
+
+//Start sampling the GPIOs of pinMask (bit0=GPIO_1 ... bit3=GPIO_4) at rateHz, into bufferPtr or into the arena if NULL
+le_result_t gpio_iot_StartCapture
+(
+    uint32_t pinMask,
+    uint32_t rateHz,
+    uint32_t sampleCount,
+    uint8_t *bufferPtr,
+    size_t bufferSize,
+    int32_t cpu,
+    gpio_iot_CaptureDoneFunc_t handlerPtr,
+    void *contextPtr
+)
+{
+    gpio_iot_Capture_t* capturePtr = &_gpio_capture;
+    int gpioIdx;
+
+    if (capturePtr->running)
+    {
+        return LE_BUSY;
+    }
+
+    if (pinMask == 0 || (pinMask & ~((1 << MAX_GPIO_COUNT) - 1)) || sampleCount == 0)
+    {
+        return LE_BAD_PARAMETER;
+    }
+
+    if (rateHz == 0 || rateHz > GPIO_IOT_CAPTURE_MAX_RATE_HZ)
+    {
+        return LE_OUT_OF_RANGE;
+    }
+
+    if (bufferPtr == NULL)
+    {
+        bufferPtr = _gpio_capture_arena;
+        bufferSize = sizeof(_gpio_capture_arena);
+    }
+
+    //2 samples per byte, computed on 64 bits so that no sampleCount can wrap around the check
+    if ((uint64_t)sampleCount > (uint64_t)bufferSize * 2)
+    {
+        return LE_OVERFLOW;
+    }
+
+    memset(capturePtr, 0, sizeof(*capturePtr));
+
+    //no file opened yet : an early failure must not close fd 0
+    for (gpioIdx = 0; gpioIdx < MAX_GPIO_COUNT; gpioIdx++)
+    {
+        capturePtr->valueFd[gpioIdx] = -1;
+    }
+
+    //open the sysfs value files once, the le_gpioPinxx pins are exported by gpioService
+    const char* sysfsDirPtr = GetGpioSysfsDir();
+
+    for (gpioIdx = 0; gpioIdx < MAX_GPIO_COUNT; gpioIdx++)
+    {
+        if (pinMask & (1 << gpioIdx))
+        {
+            char path[96];
+
+            snprintf(path, sizeof(path), "%s/gpio%d/value", sysfsDirPtr, GetFunctionPtr("Read", gpioIdx+1)->cf3GpioPinNumber);
+
+            capturePtr->valueFd[gpioIdx] = open(path, O_RDONLY | O_CLOEXEC);
+
+            if (capturePtr->valueFd[gpioIdx] < 0)
+            {
+                LE_ERROR("Capture - GPIO_%d - can't open %s : %m", gpioIdx+1, path);
+                CloseValueFiles(capturePtr);
+                return LE_UNAVAILABLE;
+            }
+        }
+    }
+
+    capturePtr->periodNs = 1000000000ULL / rateHz;
+    capturePtr->sampleCount = sampleCount;
+    capturePtr->bufferPtr = bufferPtr;
+    capturePtr->cpu = cpu;
+    capturePtr->ownerThreadRef = le_thread_GetCurrent();
+    capturePtr->handlerPtr = handlerPtr;
+    capturePtr->contextPtr = contextPtr;
+
+    le_thread_Ref_t threadRef = le_thread_Create("GpioIotCapture", CaptureThread, capturePtr);
+
+    if (le_thread_SetPriority(threadRef, LE_THREAD_PRIORITY_RT_LOWEST) != LE_OK)
+    {
+        LE_WARN("Capture thread runs without real-time priority");
+    }
+
+    capturePtr->running = true;
+
+    LE_INFO("Capture started - pins 0x%x - %u Hz - %u samples - CPU %d", pinMask, rateHz, sampleCount, cpu);
+
+    le_thread_Start(threadRef);
+
+    return LE_OK;
+}
+
+//Check whether a capture is in progress : its buffer is being written until the done handler is called
+bool gpio_iot_IsCapturing()
+{
+    return _gpio_capture.running;
+}
+
+//Stop the capture in progress, the done handler is still called with the samples taken so far
+void gpio_iot_StopCapture()
+{
+    if (_gpio_capture.running)
+    {
+        _gpio_capture.stopRequested = true;
+    }
+}
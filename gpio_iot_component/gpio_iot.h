@@ -40,6 +40,27 @@ typedef void(* 	gpio_iot_ChangeCallbackFunc_t) (bool state, void *contextPtr);
 
 typedef struct gpio_iot_ChangeEventHandler* gpio_iot_ChangeEventHandlerRef_t;
 
+//Capture : each sample is a 4-bit field (bit0=GPIO_1 ... bit3=GPIO_4), 2 samples per byte, first sample in the low nibble
+#define GPIO_IOT_CAPTURE_BYTES(sampleCount)         (((uint64_t)(sampleCount) + 1) / 2)
+#define GPIO_IOT_CAPTURE_SAMPLE(bufferPtr, index)   (((bufferPtr)[(index) / 2] >> (((index) % 2) * 4)) & 0x0F)
+
+//Size of the buffer used when no buffer is supplied to gpio_iot_StartCapture
+#define GPIO_IOT_CAPTURE_ARENA_BYTES                8192
+#define GPIO_IOT_CAPTURE_MAX_RATE_HZ                10000
+
+//sysfs layouts of the pins exported by gpioService : <dir>/gpio<CF3-Pin>/value, v2 alias layout first
+#define GPIO_IOT_SYSFS_V2_DIR                       "/sys/class/gpio/v2/alias_exported"
+#define GPIO_IOT_SYSFS_DIR                          "/sys/class/gpio"
+
+typedef struct
+{
+    uint32_t    sampleCount;            //samples stored in the buffer
+    uint32_t    achievedRateMilliHz;    //mean rate between the first and the last sample
+    uint32_t    missedDeadlines;        //grid slots which could not be sampled on time, holding the previous sample
+} gpio_iot_CaptureStats_t;
+
+typedef void(*  gpio_iot_CaptureDoneFunc_t) (le_result_t result, const uint8_t *bufferPtr, const gpio_iot_CaptureStats_t *statsPtr, void *contextPtr);
+
 
 ////////////////////////////////////////////////////////////////
 //Initializer : call this first before accessing other function
@@ -52,13 +73,13 @@ void 								gpio_iot_SetMangohType(gpio_iot_mangohType_t mangohType);
 
 
 //Configure the specified GPIO (1-4) as Output
-void                    			gpio_iot_SetPushPullOutput(uint32_t gpioNumber, bool bActiveHigh, bool bInitValue);
+le_result_t             			gpio_iot_SetPushPullOutput(uint32_t gpioNumber, bool bActiveHigh, bool bInitValue);
 //Set the output level
-void                    			gpio_iot_SetOutput(uint32_t gpioNumber, bool bActivate);
+le_result_t             			gpio_iot_SetOutput(uint32_t gpioNumber, bool bActivate);
 
 
 //Configure the specified GPIO (1-4) as Input
-void                    			gpio_iot_SetInput(uint32_t gpioNumber, bool bActiveHigh);
+le_result_t             			gpio_iot_SetInput(uint32_t gpioNumber, bool bActiveHigh);
 le_result_t             			gpio_iot_EnablePullUp(uint32_t gpioNumber);
 le_result_t             			gpio_iot_EnablePullDown(uint32_t gpioNumber);
 //Set GPIO input change handler
@@ -71,6 +92,9 @@ gpio_iot_ChangeEventHandlerRef_t  	gpio_iot_AddChangeEventHandler
                                             int32_t sampleMs
                                         );
 
+//Remove a handler previously set with gpio_iot_AddChangeEventHandler
+void                                gpio_iot_RemoveChangeEventHandler(uint32_t gpioNumber, gpio_iot_ChangeEventHandlerRef_t handlerRef);
+
 //Read the output of the specified GPIO (1-4)
 bool                    			gpio_iot_Read(uint32_t gpioNumber);				//true=activated, false=deactivated
 
@@ -80,5 +104,23 @@ gpio_iot_Edge_t        				gpio_iot_GetEdgeSense(uint32_t gpioNumber);     //0=N
 bool                    			gpio_iot_GetPolarity(uint32_t gpioNumber);		//true= ACTIVE_HIGH, false=ACTIVE_LOW
 gpio_iot_PullUpDown_t               gpio_iot_GetPullUpDown(uint32_t gpioNumber);	//0=GPIO_IOT_PULL_OFF, 1=GPIO_IOT_PULL_DOWN, 2=GPIO_IOT_PULL_UP
 
+////////////////////////////////////////////////////////////////
+//Fixed-rate capture of the GPIOs in pinMask (bit0=GPIO_1 ... bit3=GPIO_4) on a dedicated thread pinned to cpu (-1 = not pinned)
+//The GPIOs are read from their sysfs value file (GPIO_IOT_SYSFS_V2_DIR if present, GPIO_IOT_SYSFS_DIR otherwise) : they must be configured through gpioService first
+//bufferPtr must hold GPIO_IOT_CAPTURE_BYTES(sampleCount) and stay valid until handlerPtr is called; NULL to use the internal arena
+le_result_t                         gpio_iot_StartCapture
+                                        (
+                                            uint32_t pinMask,
+                                            uint32_t rateHz,
+                                            uint32_t sampleCount,
+                                            uint8_t *bufferPtr,
+                                            size_t bufferSize,
+                                            int32_t cpu,
+                                            gpio_iot_CaptureDoneFunc_t handlerPtr,
+                                            void *contextPtr
+                                        );
+void                                gpio_iot_StopCapture();
+bool                                gpio_iot_IsCapturing();
+
 
 #endif 	//_GPIO_IOT_H_